@@ -0,0 +1,468 @@
+// Loopback benchmark for the adb protocol path: spawns fake devices on socketpairs
+// or TCP loopback, connects to each with the real host handshake (auth::Sign) and
+// measures connect time, AUTH latency and sink/source throughput. --serve instead
+// runs fake devices for other hosts, e.g. the JVM ApkInstaller benchmark.
+
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "adb_protocol.h"
+#include "auth.h"
+#include "fake_adbd.h"
+#include "logging.h"
+
+using namespace adb;
+using protocol::MakePacket;
+using protocol::ReadPacket;
+using protocol::WritePacket;
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+    struct BenchOptions {
+        int devices = 1;
+        size_t payload = 4096;
+        uint64_t bytes = 64 * 1024 * 1024;
+        uint32_t latency_us = 0;
+        bool tcp = false;
+        bool source = false;
+        bool trusted = true;
+        std::string key;
+        // serve fake devices on this port instead of benchmarking, -1 to benchmark
+        int serve_port = -1;
+        uint32_t commit_delay_us = 0;
+    };
+
+    struct DeviceResult {
+        bool ok = false;
+        double connect_ms = 0;
+        double auth_ms = 0;
+        double transfer_s = 0;
+        Clock::time_point transfer_end;
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+    };
+
+    // holds every device until all handshakes are done, so the aggregate numbers
+    // only cover the window in which transfers run
+    class StartBarrier {
+    public:
+        explicit StartBarrier(int count) : count_(count) {}
+
+        void ArriveAndWait() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (--count_ == 0) {
+                start_ = Clock::now();
+                cv_.notify_all();
+            } else {
+                cv_.wait(lock, [this] { return count_ == 0; });
+            }
+        }
+
+        Clock::time_point start() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return start_;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        int count_;
+        Clock::time_point start_;
+    };
+
+    double Millis(Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    bool Send(int fd, uint32_t command, uint32_t arg0, uint32_t arg1,
+              std::string_view payload = {}) {
+        apacket p;
+        MakePacket(&p, command, arg0, arg1, payload);
+        return WritePacket(fd, p);
+    }
+
+    // host side of the CNXN/AUTH handshake, mirrors AdbDevice on the app side
+    // advertising the payload size as our max payload makes the device chunk
+    // source: data the same way we chunk sink: data
+    bool Connect(int fd, std::string &key, size_t payload, DeviceResult *result,
+                 size_t *max_payload) {
+        Clock::time_point start = Clock::now();
+        if (!Send(fd, A_CNXN, A_VERSION, payload, std::string_view("host::\0", 7))) {
+            return false;
+        }
+
+        Clock::time_point token_received;
+        bool signature_sent = false;
+        apacket p;
+        while (ReadPacket(fd, &p, MAX_PAYLOAD)) {
+            if (p.msg.command == A_CNXN) {
+                Clock::time_point now = Clock::now();
+                result->connect_ms = Millis(now - start);
+                result->auth_ms = Millis(now - token_received);
+                *max_payload = p.msg.arg1;
+                return true;
+            }
+            if (p.msg.command != A_AUTH || p.msg.arg0 != ADB_AUTH_TOKEN) {
+                continue;
+            }
+            if (!signature_sent) {
+                token_received = Clock::now();
+                std::string signature = auth::Sign(key, MAX_PAYLOAD, p.payload.data(),
+                                                   p.payload.size());
+                if (signature.empty() ||
+                    !Send(fd, A_AUTH, ADB_AUTH_SIGNATURE, 0, signature)) {
+                    return false;
+                }
+                signature_sent = true;
+            } else {
+                std::string public_key = auth::GetPublicKey(key);
+                public_key.push_back('\0');
+                if (!Send(fd, A_AUTH, ADB_AUTH_RSAPUBLICKEY, 0, public_key)) {
+                    return false;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool Transfer(int fd, const BenchOptions &options, size_t max_payload,
+                  DeviceResult *result) {
+        const uint32_t local_id = 1;
+        std::string destination = (options.source ? "source:" : "sink:") +
+                                  std::to_string(options.bytes);
+        destination.push_back('\0');
+
+        Clock::time_point start = Clock::now();
+        if (!Send(fd, A_OPEN, local_id, 0, destination)) {
+            return false;
+        }
+
+        apacket p;
+        if (!ReadPacket(fd, &p, max_payload) || p.msg.command != A_OKAY) {
+            LOGE("OPEN %s refused", destination.c_str());
+            return false;
+        }
+        uint32_t remote_id = p.msg.arg0;
+
+        if (options.source) {
+            while (ReadPacket(fd, &p, max_payload)) {
+                if (p.msg.command == A_CLSE) {
+                    break;
+                }
+                if (p.msg.command == A_WRTE) {
+                    result->messages++;
+                    result->bytes += p.payload.size();
+                    if (!Send(fd, A_OKAY, local_id, remote_id)) {
+                        return false;
+                    }
+                }
+            }
+        } else {
+            std::string chunk(max_payload, 'x');
+            uint64_t left = options.bytes;
+            while (left > 0) {
+                size_t length = std::min<uint64_t>(left, chunk.size());
+                if (!Send(fd, A_WRTE, local_id, remote_id, std::string_view(chunk).substr(0, length))) {
+                    return false;
+                }
+                if (!ReadPacket(fd, &p, max_payload) || p.msg.command != A_OKAY) {
+                    return false;
+                }
+                result->messages++;
+                result->bytes += length;
+                left -= length;
+            }
+            if (!ReadPacket(fd, &p, max_payload) || p.msg.command != A_CLSE) {
+                return false;
+            }
+        }
+        result->transfer_s = std::chrono::duration<double>(Clock::now() - start).count();
+        return result->bytes == options.bytes;
+    }
+
+    // returns a connected pair of fds, [0] for the host and [1] for the device
+    bool MakeTransport(bool tcp, int fds[2]) {
+        if (!tcp) {
+            return socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0;
+        }
+
+        fds[0] = -1;
+        int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener == -1) {
+            return false;
+        }
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        bool ok = bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 &&
+                  listen(listener, 1) == 0 &&
+                  getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &addr_len) == 0;
+        if (ok) {
+            fds[0] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            ok = fds[0] != -1 &&
+                 connect(fds[0], reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+        }
+        if (ok) {
+            fds[1] = TEMP_FAILURE_RETRY(accept4(listener, nullptr, nullptr, SOCK_CLOEXEC));
+            ok = fds[1] != -1;
+        }
+        close(listener);
+        if (!ok) {
+            PLOGE("tcp loopback");
+            if (fds[0] != -1) {
+                close(fds[0]);
+            }
+            return false;
+        }
+
+        int on = 1;
+        setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return true;
+    }
+
+    // serves a fake device on fd from a new thread, the thread closes fd when done
+    std::thread StartFakeDevice(int index, const BenchOptions &options,
+                                const std::string &public_key, int fd) {
+        fake::DeviceOptions device_options;
+        device_options.serial = "fake" + std::to_string(index);
+        if (options.trusted) {
+            device_options.trusted_keys.push_back(public_key);
+        } else {
+            device_options.accept_unknown_keys = true;
+        }
+        device_options.latency_us = options.latency_us;
+        device_options.commit_delay_us = options.commit_delay_us;
+
+        return std::thread([fd, device_options]() {
+            fake::FakeAdbd adbd(fd, device_options);
+            adbd.Serve();
+        });
+    }
+
+    void RunDevice(int index, const BenchOptions &options, const std::string &public_key,
+                   StartBarrier *barrier, DeviceResult *result) {
+        int fds[2];
+        if (!MakeTransport(options.tcp, fds)) {
+            PLOGE("transport for device %d", index);
+            barrier->ArriveAndWait();
+            return;
+        }
+
+        std::thread device = StartFakeDevice(index, options, public_key, fds[1]);
+
+        std::string key = options.key;
+        size_t max_payload = 0;
+        bool connected = Connect(fds[0], key, options.payload, result, &max_payload);
+        barrier->ArriveAndWait();
+        result->ok = connected && Transfer(fds[0], options, max_payload, result);
+        result->transfer_end = Clock::now();
+        if (!result->ok) {
+            LOGE("device %d failed", index);
+        }
+
+        // closing our end makes the fake device see EOF and return
+        close(fds[0]);
+        device.join();
+    }
+
+    void PrintStat(const char *name, const std::vector<double> &values) {
+        if (values.empty()) {
+            return;
+        }
+        double sum = 0;
+        for (double v: values) {
+            sum += v;
+        }
+        printf("%-16s min %10.3f  avg %10.3f  max %10.3f\n", name,
+               *std::min_element(values.begin(), values.end()), sum / values.size(),
+               *std::max_element(values.begin(), values.end()));
+    }
+
+    // accepts hosts on 127.0.0.1:port until killed, serving a fake device to each. The
+    // port is printed first so a harness can pass 0 and read back the chosen one.
+    int Serve(const BenchOptions &options, const std::string &public_key) {
+        int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener == -1) {
+            PLOGE("socket");
+            return 1;
+        }
+        int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(options.serve_port);
+        socklen_t addr_len = sizeof(addr);
+        if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            listen(listener, SOMAXCONN) != 0 ||
+            getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &addr_len) != 0) {
+            PLOGE("listen on port %d", options.serve_port);
+            close(listener);
+            return 1;
+        }
+        printf("port %d\n", ntohs(addr.sin_port));
+        fflush(stdout);
+
+        for (int index = 0;; index++) {
+            int fd = TEMP_FAILURE_RETRY(accept4(listener, nullptr, nullptr, SOCK_CLOEXEC));
+            if (fd == -1) {
+                PLOGE("accept");
+                close(listener);
+                return 1;
+            }
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            StartFakeDevice(index, options, public_key, fd).detach();
+        }
+    }
+
+    void Usage(const char *name) {
+        fprintf(stderr,
+                "usage: %s [options]\n"
+                "  -n, --devices N      number of fake devices (default 1)\n"
+                "  -p, --payload BYTES  A_WRTE payload size, at least 256 (default 4096)\n"
+                "  -b, --bytes BYTES    bytes transferred per device (default 64M)\n"
+                "  -l, --latency US     latency injected before each device packet\n"
+                "  -t, --tcp            use TCP loopback instead of socketpairs\n"
+                "  -s, --source         measure device->host instead of host->device\n"
+                "  -u, --untrusted      key is not preloaded, authenticate via RSAPUBLICKEY\n"
+                "  -k, --key FILE       adb private key (generated if missing)\n"
+                "  -S, --serve PORT     serve fake devices on 127.0.0.1:PORT (0 picks one)\n"
+                "  -c, --commit-delay US  time the fake devices spend in install-commit\n",
+                name);
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    options.key = "/tmp/adb_bench_key";
+
+    static const option long_options[] = {
+            {"devices",   required_argument, nullptr, 'n'},
+            {"payload",   required_argument, nullptr, 'p'},
+            {"bytes",     required_argument, nullptr, 'b'},
+            {"latency",   required_argument, nullptr, 'l'},
+            {"tcp",       no_argument,       nullptr, 't'},
+            {"source",    no_argument,       nullptr, 's'},
+            {"untrusted", no_argument,       nullptr, 'u'},
+            {"key",       required_argument, nullptr, 'k'},
+            {"serve",     required_argument, nullptr, 'S'},
+            {"commit-delay", required_argument, nullptr, 'c'},
+            {nullptr, 0,                     nullptr, 0},
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "n:p:b:l:tsuk:S:c:", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'n':
+                options.devices = atoi(optarg);
+                break;
+            case 'p':
+                options.payload = strtoull(optarg, nullptr, 10);
+                break;
+            case 'b':
+                options.bytes = strtoull(optarg, nullptr, 10);
+                break;
+            case 'l':
+                options.latency_us = strtoul(optarg, nullptr, 10);
+                break;
+            case 't':
+                options.tcp = true;
+                break;
+            case 's':
+                options.source = true;
+                break;
+            case 'u':
+                options.trusted = false;
+                break;
+            case 'k':
+                options.key = optarg;
+                break;
+            case 'S':
+                options.serve_port = atoi(optarg);
+                break;
+            case 'c':
+                options.commit_delay_us = strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if (options.devices < 1 || options.serve_port > 65535 || options.payload < MIN_PAYLOAD || options.payload > MAX_PAYLOAD) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    struct stat buf;
+    if (stat(options.key.c_str(), &buf) == -1 && !auth::GenerateKey(options.key)) {
+        LOGE("Failed to generate key '%s'", options.key.c_str());
+        return 1;
+    }
+    std::string public_key = auth::GetPublicKey(options.key);
+    if (public_key.empty()) {
+        return 1;
+    }
+
+    if (options.serve_port >= 0) {
+        return Serve(options, public_key);
+    }
+
+    std::vector<DeviceResult> results(options.devices);
+    std::vector<std::thread> hosts;
+    StartBarrier barrier(options.devices);
+    for (int i = 0; i < options.devices; i++) {
+        hosts.emplace_back(RunDevice, i, std::cref(options), std::cref(public_key), &barrier,
+                           &results[i]);
+    }
+    for (std::thread &host: hosts) {
+        host.join();
+    }
+
+    std::vector<double> connect_ms, auth_ms, device_mb_s;
+    uint64_t messages = 0, bytes = 0;
+    int failed = 0;
+    Clock::time_point end = barrier.start();
+    for (const DeviceResult &r: results) {
+        if (!r.ok) {
+            failed++;
+            continue;
+        }
+        end = std::max(end, r.transfer_end);
+        connect_ms.push_back(r.connect_ms);
+        auth_ms.push_back(r.auth_ms);
+        device_mb_s.push_back(r.bytes / r.transfer_s / (1024 * 1024));
+        messages += r.messages;
+        bytes += r.bytes;
+    }
+
+    double wall_s = std::chrono::duration<double>(end - barrier.start()).count();
+
+    printf("devices %d (%d failed), %s, %s, payload %zu, latency %u us\n",
+           options.devices, failed, options.tcp ? "tcp" : "socketpair",
+           options.source ? "source" : "sink", options.payload, options.latency_us);
+    PrintStat("connect ms", connect_ms);
+    PrintStat("auth ms", auth_ms);
+    PrintStat("device MB/s", device_mb_s);
+    printf("%-16s %10.0f\n", "messages/s", messages / wall_s);
+    printf("%-16s %10.3f\n", "MB/s", bytes / wall_s / (1024 * 1024));
+    return failed == 0 ? 0 : 1;
+}
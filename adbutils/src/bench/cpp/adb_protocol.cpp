@@ -0,0 +1,94 @@
+#include "adb_protocol.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "logging.h"
+#include "utils.h"
+
+namespace adb {
+    namespace protocol {
+        static uint32_t Checksum(std::string_view payload) {
+            uint32_t sum = 0;
+            for (unsigned char c: payload) {
+                sum += c;
+            }
+            return sum;
+        }
+
+        static bool ReadFully(int fd, void *data, size_t size) {
+            auto *p = reinterpret_cast<char *>(data);
+            while (size > 0) {
+                ssize_t n = TEMP_FAILURE_RETRY(read(fd, p, size));
+                if (n <= 0) {
+                    return false;
+                }
+                p += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        void MakePacket(apacket *p, uint32_t command, uint32_t arg0, uint32_t arg1,
+                        std::string_view payload) {
+            p->msg.command = command;
+            p->msg.arg0 = arg0;
+            p->msg.arg1 = arg1;
+            p->msg.data_length = payload.size();
+            p->msg.data_check = Checksum(payload);
+            p->msg.magic = command ^ 0xffffffff;
+            p->payload.assign(payload.data(), payload.size());
+        }
+
+        bool WritePacket(int fd, const apacket &p) {
+            struct iovec iov[2] = {
+                    {const_cast<amessage *>(&p.msg),     sizeof(p.msg)},
+                    {const_cast<char *>(p.payload.data()), p.payload.size()},
+            };
+            ssize_t total = sizeof(p.msg) + p.payload.size();
+            ssize_t n = TEMP_FAILURE_RETRY(writev(fd, iov, p.payload.empty() ? 1 : 2));
+            if (n == -1) {
+                return false;
+            }
+            if (n == total) {
+                return true;
+            }
+
+            // short write, finish the remainder the slow way
+            std::string_view header(reinterpret_cast<const char *>(&p.msg), sizeof(p.msg));
+            if (static_cast<size_t>(n) < header.size()) {
+                if (!file::WriteStringToFd(header.substr(n), fd)) {
+                    return false;
+                }
+                n = header.size();
+            }
+            return file::WriteStringToFd(std::string_view(p.payload).substr(n - header.size()), fd);
+        }
+
+        bool ReadPacket(int fd, apacket *p, size_t max_payload) {
+            if (!ReadFully(fd, &p->msg, sizeof(p->msg))) {
+                return false;
+            }
+            if (p->msg.magic != (p->msg.command ^ 0xffffffff)) {
+                LOGE("Invalid packet magic 0x%08x", p->msg.magic);
+                return false;
+            }
+            if (p->msg.data_length > max_payload) {
+                LOGE("Packet payload too large %u > %zu", p->msg.data_length, max_payload);
+                return false;
+            }
+            p->payload.resize(p->msg.data_length);
+            if (!ReadFully(fd, p->payload.data(), p->payload.size())) {
+                return false;
+            }
+            // both ends speak A_VERSION 0x01000000, which still requires checksums
+            uint32_t checksum = Checksum(p->payload);
+            if (checksum != p->msg.data_check) {
+                LOGE("Packet checksum mismatch 0x%08x != 0x%08x", checksum, p->msg.data_check);
+                return false;
+            }
+            return true;
+        }
+    } // namespace protocol
+} // namespace adb
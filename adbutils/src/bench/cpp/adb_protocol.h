@@ -0,0 +1,52 @@
+#ifndef ADB_PROTOCOL_H
+#define ADB_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#define A_SYNC 0x434e5953
+#define A_CNXN 0x4e584e43
+#define A_OPEN 0x4e45504f
+#define A_OKAY 0x59414b4f
+#define A_CLSE 0x45534c43
+#define A_WRTE 0x45545257
+#define A_AUTH 0x48545541
+
+#define A_VERSION 0x01000000
+
+#define ADB_AUTH_TOKEN 1
+#define ADB_AUTH_SIGNATURE 2
+#define ADB_AUTH_RSAPUBLICKEY 3
+
+// smallest max payload either side accepts: the CNXN banner, OPEN destinations and
+// service replies are never split across packets
+#define MIN_PAYLOAD 256
+
+struct amessage {
+    uint32_t command;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t data_length;
+    uint32_t data_check;
+    uint32_t magic;
+};
+
+struct apacket {
+    amessage msg;
+    std::string payload;
+};
+
+namespace adb {
+    namespace protocol {
+        void MakePacket(apacket *p, uint32_t command, uint32_t arg0, uint32_t arg1,
+                        std::string_view payload = {});
+
+        bool WritePacket(int fd, const apacket &p);
+
+        // reads one packet, rejecting bad magic or checksum and payloads larger than max_payload
+        bool ReadPacket(int fd, apacket *p, size_t max_payload);
+    } // namespace protocol
+} // namespace adb
+
+#endif // ADB_PROTOCOL_H
@@ -0,0 +1,340 @@
+#include "fake_adbd.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <openssl/base64.h>
+#include <openssl/nid.h>
+#include <openssl/rand.h>
+
+#include "crypto_utils.h"
+#include "logging.h"
+
+namespace adb {
+    namespace fake {
+        using protocol::ReadPacket;
+
+        static constexpr char kPackageService[] = "exec:cmd package ";
+
+        // decodes the base64 part of an adbkey.pub line ("<base64> user@host")
+        static bssl::UniquePtr<RSA> DecodePublicKey(std::string_view line) {
+            std::string_view b64 = line.substr(0, line.find_first_of(" \n\0", 0, 3));
+
+            size_t length;
+            if (!EVP_DecodedLength(&length, b64.size())) {
+                return nullptr;
+            }
+
+            std::vector<uint8_t> decoded(length);
+            if (!EVP_DecodeBase64(decoded.data(), &length, decoded.size(),
+                                  reinterpret_cast<const uint8_t *>(b64.data()), b64.size())) {
+                return nullptr;
+            }
+
+            RSA *key = nullptr;
+            if (!pubkey_decode(decoded.data(), length, &key)) {
+                return nullptr;
+            }
+            return bssl::UniquePtr<RSA>(key);
+        }
+
+        FakeAdbd::FakeAdbd(int fd, DeviceOptions options)
+                : fd_(fd), options_(std::move(options)), max_payload_(options_.max_payload) {
+            for (const std::string &line: options_.trusted_keys) {
+                bssl::UniquePtr<RSA> key = DecodePublicKey(line);
+                if (!key) {
+                    LOGW("%s: ignoring undecodable public key", options_.serial.c_str());
+                    continue;
+                }
+                keys_.push_back(std::move(key));
+            }
+        }
+
+        FakeAdbd::~FakeAdbd() {
+            close(fd_);
+        }
+
+        bool FakeAdbd::Send(uint32_t command, uint32_t arg0, uint32_t arg1,
+                            std::string_view payload) {
+            if (options_.latency_us > 0) {
+                usleep(options_.latency_us);
+            }
+            apacket p;
+            protocol::MakePacket(&p, command, arg0, arg1, payload);
+            return protocol::WritePacket(fd_, p);
+        }
+
+        bool FakeAdbd::SendToken() {
+            RAND_bytes(token_, sizeof(token_));
+            return Send(A_AUTH, ADB_AUTH_TOKEN, 0,
+                        std::string_view(reinterpret_cast<const char *>(token_), sizeof(token_)));
+        }
+
+        bool FakeAdbd::VerifySignature(const std::string &signature) {
+            for (const auto &key: keys_) {
+                if (RSA_verify(NID_sha1, token_, sizeof(token_),
+                               reinterpret_cast<const uint8_t *>(signature.data()),
+                               signature.size(), key.get())) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool FakeAdbd::Handshake() {
+            // signatures and public keys can exceed a small host max payload, so the
+            // negotiated limit only applies once the connection is up
+            apacket p;
+            if (!ReadPacket(fd_, &p, options_.max_payload) || p.msg.command != A_CNXN) {
+                LOGE("%s: expected CNXN", options_.serial.c_str());
+                return false;
+            }
+            size_t host_max_payload = p.msg.arg1;
+            if (host_max_payload < MIN_PAYLOAD) {
+                LOGE("%s: host max payload %zu below %d", options_.serial.c_str(), host_max_payload,
+                     MIN_PAYLOAD);
+                return false;
+            }
+
+            if (!SendToken()) {
+                return false;
+            }
+
+            while (ReadPacket(fd_, &p, options_.max_payload)) {
+                if (p.msg.command != A_AUTH) {
+                    LOGE("%s: unexpected command 0x%08x during auth", options_.serial.c_str(),
+                         p.msg.command);
+                    return false;
+                }
+
+                bool authorized = false;
+                if (p.msg.arg0 == ADB_AUTH_SIGNATURE) {
+                    if (!VerifySignature(p.payload)) {
+                        // rejected, the host should retry or offer its public key
+                        if (!SendToken()) {
+                            return false;
+                        }
+                        continue;
+                    }
+                    authorized = true;
+                } else if (p.msg.arg0 == ADB_AUTH_RSAPUBLICKEY) {
+                    if (!options_.accept_unknown_keys) {
+                        LOGE("%s: refusing unknown public key", options_.serial.c_str());
+                        return false;
+                    }
+                    bssl::UniquePtr<RSA> key = DecodePublicKey(p.payload);
+                    if (!key) {
+                        LOGE("%s: invalid public key", options_.serial.c_str());
+                        return false;
+                    }
+                    keys_.push_back(std::move(key));
+                    authorized = true;
+                }
+
+                if (authorized) {
+                    max_payload_ = std::min(options_.max_payload, host_max_payload);
+                    std::string banner = "device::ro.product.name=" + options_.serial + ";";
+                    banner.push_back('\0');
+                    return Send(A_CNXN, A_VERSION, max_payload_, banner);
+                }
+            }
+            return false;
+        }
+
+        bool FakeAdbd::SendChunk(uint32_t local_id, Stream *stream) {
+            if (stream->remaining == 0) {
+                uint32_t remote_id = stream->remote_id;
+                streams_.erase(local_id);
+                return Send(A_CLSE, local_id, remote_id);
+            }
+            size_t length = std::min<uint64_t>(stream->remaining, max_payload_);
+            stream->remaining -= length;
+            return Send(A_WRTE, local_id, stream->remote_id,
+                        std::string_view(source_data_).substr(0, length));
+        }
+
+        bool FakeAdbd::Reply(uint32_t remote_id, std::string_view text) {
+            uint32_t local_id = next_id_++;
+            return Send(A_OKAY, local_id, remote_id) &&
+                   Send(A_WRTE, local_id, remote_id, text) &&
+                   Send(A_CLSE, local_id, remote_id);
+        }
+
+        bool FakeAdbd::HandlePackage(uint32_t remote_id, std::string_view command) {
+            std::vector<std::string> args;
+            size_t pos = 0;
+            while (pos < command.size()) {
+                size_t end = command.find(' ', pos);
+                if (end == std::string_view::npos) {
+                    end = command.size();
+                }
+                if (end > pos) {
+                    args.emplace_back(command.substr(pos, end - pos));
+                }
+                pos = end + 1;
+            }
+
+            // split "-S <size>" from the positional arguments
+            uint64_t size = 0;
+            std::vector<std::string> positional;
+            for (size_t i = 1; i < args.size(); i++) {
+                if (args[i] == "-S" && i + 1 < args.size()) {
+                    size = strtoull(args[++i].c_str(), nullptr, 10);
+                } else {
+                    positional.push_back(args[i]);
+                }
+            }
+            const std::string verb = args.empty() ? "" : args[0];
+            uint32_t session_id = positional.empty() ? 0 : strtoul(positional[0].c_str(), nullptr, 10);
+            auto session = sessions_.find(session_id);
+
+            if (verb == "install-create") {
+                session_id = next_session_++;
+                sessions_[session_id] = Session{size, 0};
+                return Reply(remote_id, "Success: created install session [" +
+                                        std::to_string(session_id) + "]\n");
+            }
+            if (session == sessions_.end()) {
+                return Reply(remote_id, "Failure [INSTALL_FAILED_INTERNAL_ERROR: bad session]\n");
+            }
+            if (verb == "install-write") {
+                uint32_t local_id = next_id_++;
+                Stream &stream = streams_[local_id];
+                stream.remote_id = remote_id;
+                stream.service = Service::kInstallWrite;
+                stream.remaining = size;
+                stream.total = size;
+                stream.session = session_id;
+                if (!Send(A_OKAY, local_id, remote_id)) {
+                    return false;
+                }
+                return size > 0 || FinishWrite(local_id);
+            }
+            if (verb == "install-commit") {
+                if (options_.commit_delay_us > 0) {
+                    usleep(options_.commit_delay_us);
+                }
+                bool complete = session->second.size == 0 ||
+                                session->second.written == session->second.size;
+                sessions_.erase(session);
+                return Reply(remote_id, complete ? "Success\n" :
+                                        "Failure [INSTALL_FAILED_INVALID_APK: short write]\n");
+            }
+            if (verb == "install-abandon") {
+                sessions_.erase(session);
+                return Reply(remote_id, "Success\n");
+            }
+            // the verb comes from the destination, keep the reply within MIN_PAYLOAD
+            return Reply(remote_id, "Unknown command: " + verb.substr(0, 64) + "\n");
+        }
+
+        bool FakeAdbd::FinishWrite(uint32_t local_id) {
+            Stream &stream = streams_[local_id];
+            uint32_t remote_id = stream.remote_id;
+            std::string text = "Success: streamed " + std::to_string(stream.total) + " bytes\n";
+            streams_.erase(local_id);
+            return Send(A_WRTE, local_id, remote_id, text) && Send(A_CLSE, local_id, remote_id);
+        }
+
+        bool FakeAdbd::HandleOpen(const apacket &p) {
+            std::string_view destination(p.payload.c_str());
+            if (destination.rfind(kPackageService, 0) == 0) {
+                return HandlePackage(p.msg.arg0, destination.substr(strlen(kPackageService)));
+            }
+
+            bool sink = destination.rfind("sink:", 0) == 0;
+            bool source = destination.rfind("source:", 0) == 0;
+            if (!sink && !source) {
+                LOGW("%s: unsupported service '%s'", options_.serial.c_str(),
+                     std::string(destination).c_str());
+                return Send(A_CLSE, 0, p.msg.arg0);
+            }
+
+            uint32_t local_id = next_id_++;
+            Stream &stream = streams_[local_id];
+            stream.remote_id = p.msg.arg0;
+            stream.service = sink ? Service::kSink : Service::kSource;
+            stream.remaining = strtoull(destination.data() + destination.find(':') + 1, nullptr, 10);
+
+            if (!Send(A_OKAY, local_id, stream.remote_id)) {
+                return false;
+            }
+            if (source) {
+                if (source_data_.size() < max_payload_) {
+                    source_data_.assign(max_payload_, 'x');
+                }
+                return SendChunk(local_id, &stream);
+            }
+            if (stream.remaining == 0) {
+                streams_.erase(local_id);
+                return Send(A_CLSE, local_id, p.msg.arg0);
+            }
+            return true;
+        }
+
+        bool FakeAdbd::HandlePacket(const apacket &p) {
+            switch (p.msg.command) {
+                case A_OPEN:
+                    return HandleOpen(p);
+                case A_WRTE: {
+                    auto it = streams_.find(p.msg.arg1);
+                    if (it == streams_.end() || it->second.service == Service::kSource) {
+                        return Send(A_CLSE, 0, p.msg.arg0);
+                    }
+                    uint32_t local_id = it->first;
+                    Stream &stream = it->second;
+                    uint64_t length = std::min<uint64_t>(stream.remaining, p.payload.size());
+                    stream.remaining -= length;
+                    if (stream.service == Service::kInstallWrite) {
+                        auto session = sessions_.find(stream.session);
+                        if (session != sessions_.end()) {
+                            session->second.written += length;
+                        }
+                    }
+                    if (!Send(A_OKAY, local_id, stream.remote_id)) {
+                        return false;
+                    }
+                    if (stream.remaining > 0) {
+                        return true;
+                    }
+                    if (stream.service == Service::kInstallWrite) {
+                        return FinishWrite(local_id);
+                    }
+                    uint32_t remote_id = stream.remote_id;
+                    streams_.erase(it);
+                    return Send(A_CLSE, local_id, remote_id);
+                }
+                case A_OKAY: {
+                    auto it = streams_.find(p.msg.arg1);
+                    if (it != streams_.end() && it->second.service == Service::kSource) {
+                        return SendChunk(it->first, &it->second);
+                    }
+                    return true;
+                }
+                case A_CLSE:
+                    streams_.erase(p.msg.arg1);
+                    return true;
+                default:
+                    LOGW("%s: ignoring command 0x%08x", options_.serial.c_str(), p.msg.command);
+                    return true;
+            }
+        }
+
+        bool FakeAdbd::Serve() {
+            if (!Handshake()) {
+                return false;
+            }
+
+            apacket p;
+            while (ReadPacket(fd_, &p, max_payload_)) {
+                if (!HandlePacket(p)) {
+                    return false;
+                }
+            }
+            // host disconnected
+            return true;
+        }
+    } // namespace fake
+} // namespace adb
@@ -0,0 +1,100 @@
+#ifndef ADB_FAKE_ADBD_H
+#define ADB_FAKE_ADBD_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <openssl/rsa.h>
+
+#include "adb_protocol.h"
+#include "auth.h"
+
+namespace adb {
+    namespace fake {
+        struct DeviceOptions {
+            std::string serial = "fake_adbd";
+            // contents of adbkey.pub files allowed to authenticate
+            std::vector<std::string> trusted_keys;
+            // accept AUTH_RSAPUBLICKEY instead of prompting, like a user tapping "Allow"
+            bool accept_unknown_keys = false;
+            size_t max_payload = MAX_PAYLOAD;
+            // delay before every packet the device sends
+            uint32_t latency_us = 0;
+            // time install-commit takes, standing in for verification and dexopt
+            uint32_t commit_delay_us = 0;
+        };
+
+        // A device side adb endpoint running the real CNXN/AUTH handshake over any
+        // stream fd. Services:
+        //   sink:<bytes>    consumes <bytes> of A_WRTE data, then closes
+        //   source:<bytes>  sends <bytes> of data in max_payload chunks, then closes
+        //   exec:cmd package install-create/install-write/install-commit/install-abandon
+        //                   a package manager session that counts the streamed bytes
+        class FakeAdbd {
+        public:
+            FakeAdbd(int fd, DeviceOptions options);
+
+            ~FakeAdbd();
+
+            // serves the connection until the host disconnects; returns false on a
+            // protocol or authentication failure
+            bool Serve();
+
+        private:
+            enum class Service {
+                kSink,
+                kSource,
+                kInstallWrite,
+            };
+
+            struct Stream {
+                uint32_t remote_id;
+                Service service;
+                uint64_t remaining;
+                uint64_t total;
+                uint32_t session;
+            };
+
+            struct Session {
+                uint64_t size;
+                uint64_t written;
+            };
+
+            bool Handshake();
+
+            bool SendToken();
+
+            bool VerifySignature(const std::string &signature);
+
+            bool HandlePacket(const apacket &p);
+
+            bool HandleOpen(const apacket &p);
+
+            bool SendChunk(uint32_t local_id, Stream *stream);
+
+            // answers a one shot command: OKAY, the text as A_WRTE, then CLSE
+            bool Reply(uint32_t remote_id, std::string_view text);
+
+            bool HandlePackage(uint32_t remote_id, std::string_view command);
+
+            bool FinishWrite(uint32_t local_id);
+
+            bool Send(uint32_t command, uint32_t arg0, uint32_t arg1, std::string_view payload = {});
+
+            int fd_;
+            DeviceOptions options_;
+            std::vector<bssl::UniquePtr<RSA>> keys_;
+            uint8_t token_[TOKEN_SIZE];
+            size_t max_payload_;
+            uint32_t next_id_ = 1;
+            std::unordered_map<uint32_t, Stream> streams_;
+            uint32_t next_session_ = 1;
+            std::unordered_map<uint32_t, Session> sessions_;
+            std::string source_data_;
+        };
+    } // namespace fake
+} // namespace adb
+
+#endif // ADB_FAKE_ADBD_H
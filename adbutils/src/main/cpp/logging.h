@@ -6,6 +6,9 @@
 #define ADB_LOGGING_H
 
 #include <errno.h>
+#include <string.h>
+
+#ifdef __ANDROID__
 #include <android/log.h>
 
 #define LOG_TAG    "adb_utils"
@@ -15,6 +18,24 @@
 #define LOGI(...)  __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGW(...)  __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
 #define LOGE(...)  __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#include <stdio.h>
+
+// host builds (fake adbd, benchmarks) log to stderr, debug output only in DEBUG builds
+#define LOG_PRINT(level, fmt, args...) fprintf(stderr, level " " fmt "\n", ##args)
+
+#ifdef DEBUG
+#define LOGD(...)  LOG_PRINT("D", __VA_ARGS__)
+#define LOGV(...)  LOG_PRINT("V", __VA_ARGS__)
+#else
+#define LOGD(...)  ((void) 0)
+#define LOGV(...)  ((void) 0)
+#endif
+#define LOGI(...)  LOG_PRINT("I", __VA_ARGS__)
+#define LOGW(...)  LOG_PRINT("W", __VA_ARGS__)
+#define LOGE(...)  LOG_PRINT("E", __VA_ARGS__)
+#endif
+
 #define PLOGE(fmt, args...) LOGE(fmt " failed with %d: %s", ##args, errno, strerror(errno))
 
 #endif // ADB_LOGGING_H
@@ -10,20 +10,31 @@ import android.hardware.usb.UsbDevice
 import android.hardware.usb.UsbDeviceConnection
 import android.hardware.usb.UsbInterface
 import android.hardware.usb.UsbManager
+import android.net.Uri
 import android.os.Build
 import android.os.Bundle
 import android.os.Handler
 import android.os.Looper
 import android.os.Message
+import android.view.Menu
+import android.view.MenuItem
 
+import androidx.activity.result.contract.ActivityResultContracts
 import androidx.appcompat.app.AppCompatActivity
 import androidx.core.content.ContextCompat
 
 import dev.rohitverma882.adbtest.adb.AdbDevice
+import dev.rohitverma882.adbtest.adb.ApkInstaller
 import dev.rohitverma882.adbtest.adb.UsbReceiver
+import dev.rohitverma882.adbtest.adb.UsbTransport
 import dev.rohitverma882.adbtest.databinding.ActivityMainBinding
 
-class MainActivity : AppCompatActivity() {
+import java.io.File
+import java.io.IOException
+
+import kotlin.concurrent.thread
+
+class MainActivity : AppCompatActivity(), AdbDevice.Listener {
     private lateinit var binding: ActivityMainBinding
 
     private val usbManager by lazy {
@@ -39,6 +50,16 @@ class MainActivity : AppCompatActivity() {
     private var usbInterface: UsbInterface? = null
     private var adbDevice: AdbDevice? = null
 
+    // devices that finished the handshake, only touched on the main thread
+    private val onlineDevices = mutableListOf<AdbDevice>()
+
+    private val pickApks =
+        registerForActivityResult(ActivityResultContracts.OpenMultipleDocuments()) { uris ->
+            if (uris.isNotEmpty()) {
+                installApks(uris)
+            }
+        }
+
     private var usbReceiver = object : BroadcastReceiver() {
         override fun onReceive(context: Context?, intent: Intent?) {
             when (intent?.action) {
@@ -157,7 +178,56 @@ class MainActivity : AppCompatActivity() {
         )
     }
 
-    fun log(s: String) {
+    override fun onCreateOptionsMenu(menu: Menu): Boolean {
+        menuInflater.inflate(R.menu.menu_main, menu)
+        return true
+    }
+
+    override fun onOptionsItemSelected(item: MenuItem): Boolean {
+        return when (item.itemId) {
+            R.id.action_install -> {
+                pickApks.launch(arrayOf(APK_MIME_TYPE))
+                true
+            }
+
+            else -> super.onOptionsItemSelected(item)
+        }
+    }
+
+    // installs the picked splits as one package on every online device
+    private fun installApks(uris: List<Uri>) {
+        if (onlineDevices.isEmpty()) {
+            log("install: no device online")
+            return
+        }
+        val devices = onlineDevices.toList()
+        thread(name = "ApkInstaller") {
+            // ApkInstaller maps files, so copy the documents into the cache first
+            val dir = File(cacheDir, "splits")
+            dir.mkdirs()
+            val splits = mutableListOf<File>()
+            try {
+                uris.forEachIndexed { i, uri ->
+                    val split = File(dir, "split$i.apk")
+                    splits.add(split)
+                    val input = contentResolver.openInputStream(uri)
+                        ?: throw IOException("can't open $uri")
+                    input.use { split.outputStream().use { output -> input.copyTo(output) } }
+                }
+                log("install: ${splits.size} splits on ${devices.size} devices")
+                val installed = ApkInstaller(devices, splits).install()
+                devices.forEach {
+                    log("install ${if (it in installed) "succeeded" else "failed"}: ${it.serial}")
+                }
+            } catch (e: IOException) {
+                log("install: $e")
+            } finally {
+                splits.forEach { it.delete() }
+            }
+        }
+    }
+
+    override fun log(s: String) {
         val m = Message.obtain(handler, MESSAGE_LOG)
         m.obj = s
         handler.sendMessage(m)
@@ -174,7 +244,7 @@ class MainActivity : AppCompatActivity() {
         }
     }
 
-    fun deviceOnline(device: AdbDevice) {
+    override fun deviceOnline(device: AdbDevice) {
         val m = Message.obtain(handler, MESSAGE_DEVICE_ONLINE)
         m.obj = device
         handler.sendMessage(m)
@@ -182,6 +252,7 @@ class MainActivity : AppCompatActivity() {
 
     private fun handleDeviceOnline(device: AdbDevice) {
         log("device online: " + device.serial)
+        onlineDevices.add(device)
 //        device.openSocket("shell:exec logcat")
         device.openSocket("shell:exec pm")
     }
@@ -228,7 +299,8 @@ class MainActivity : AppCompatActivity() {
                     usbDevice = device
                     usbDeviceConnection = connection
                     usbInterface = adbInterface
-                    adbDevice = AdbDevice(this, usbDeviceConnection, adbInterface)
+                    adbDevice?.let { onlineDevices.remove(it) }
+                    adbDevice = AdbDevice(this, UsbTransport(connection, adbInterface), connection.serial)
                     log("call start")
                     adbDevice?.start()
                     return true
@@ -241,6 +313,7 @@ class MainActivity : AppCompatActivity() {
             }
         }
         if (usbDeviceConnection == null && adbDevice != null) {
+            onlineDevices.remove(adbDevice)
             adbDevice?.stop()
             adbDevice = null
         }
@@ -284,5 +357,7 @@ class MainActivity : AppCompatActivity() {
 
         private const val MESSAGE_LOG = 1
         private const val MESSAGE_DEVICE_ONLINE = 2
+
+        private const val APK_MIME_TYPE = "application/vnd.android.package-archive"
     }
 }
\ No newline at end of file
@@ -16,66 +16,66 @@
 
 package dev.rohitverma882.adbtest.adb;
 
-import android.hardware.usb.UsbConstants;
-import android.hardware.usb.UsbDeviceConnection;
-import android.hardware.usb.UsbEndpoint;
-import android.hardware.usb.UsbInterface;
-import android.hardware.usb.UsbRequest;
-import android.util.SparseArray;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.Map;
 
-import java.util.LinkedList;
-
-import dev.rohitverma882.adbtest.MainActivity;
 import dev.rohitverma882.adbutils.AdbUtils;
 
-/* This class represents a USB device that supports the adb protocol. */
+/* This class represents a device that supports the adb protocol, reached
+ * through an AdbTransport (USB on the phone, a socket for fake devices).
+ */
 public class AdbDevice {
-    private final MainActivity mActivity;
-    private final UsbDeviceConnection mDeviceConnection;
-    private final UsbEndpoint mEndpointOut;
-    private final UsbEndpoint mEndpointIn;
-    private final String mSerial;
+    // receives log lines and the connected event, implemented by MainActivity
+    public interface Listener {
+        void log(String s);
 
-    // pool of requests for the OUT endpoint
-    private final LinkedList<UsbRequest> mOutRequestPool = new LinkedList<>();
+        void deviceOnline(AdbDevice device);
+    }
 
-    // pool of requests for the IN endpoint
-    private final LinkedList<UsbRequest> mInRequestPool = new LinkedList<>();
+    // answers AUTH challenges
+    public interface Signer {
+        byte[] sign(byte[] token);
 
-    // list of currently opened sockets
-    private final SparseArray<AdbSocket> mSockets = new SparseArray<>();
-    private int mNextSocketId = 1;
+        // adb public key, NUL terminated
+        byte[] getPublicKey();
+    }
 
-    private final WaiterThread mWaiterThread = new WaiterThread();
+    // signs with the app's adbkey through adbutils, AdbUtils is only loaded on first use
+    public static final Signer DEFAULT_SIGNER = new Signer() {
+        @Override
+        public byte[] sign(byte[] token) {
+            return AdbUtils.sign(token);
+        }
 
-    private boolean signatureSent = false;
+        @Override
+        public byte[] getPublicKey() {
+            return AdbUtils.getPublicKey();
+        }
+    };
+
+    private final Listener mListener;
+    private final AdbTransport mTransport;
+    private final Signer mSigner;
+    private final String mSerial;
 
-    public AdbDevice(MainActivity activity, UsbDeviceConnection connection, UsbInterface adbInterface) {
-        mActivity = activity;
-        mDeviceConnection = connection;
-        mSerial = connection.getSerial();
+    // list of currently opened sockets
+    private final Map<Integer, AdbSocket> mSockets = new HashMap<>();
+    private int mNextSocketId = 1;
 
-        UsbEndpoint epOut = null;
-        UsbEndpoint epIn = null;
+    private final ReaderThread mReaderThread = new ReaderThread();
 
-        // look for our bulk endpoints
-        for (int i = 0; i < adbInterface.getEndpointCount(); i++) {
-            UsbEndpoint ep = adbInterface.getEndpoint(i);
-            if (ep.getType() == UsbConstants.USB_ENDPOINT_XFER_BULK) {
-                if (ep.getDirection() == UsbConstants.USB_DIR_OUT) {
-                    epOut = ep;
-                } else {
-                    epIn = ep;
-                }
-            }
-        }
+    private boolean signatureSent = false;
 
-        if (epOut == null || epIn == null) {
-            throw new IllegalArgumentException("not all endpoints found");
-        }
+    public AdbDevice(Listener listener, AdbTransport transport, String serial) {
+        this(listener, transport, serial, DEFAULT_SIGNER);
+    }
 
-        mEndpointOut = epOut;
-        mEndpointIn = epIn;
+    public AdbDevice(Listener listener, AdbTransport transport, String serial, Signer signer) {
+        mListener = listener;
+        mTransport = transport;
+        mSerial = serial;
+        mSigner = signer;
     }
 
     // return device serial number
@@ -83,60 +83,39 @@ public class AdbDevice {
         return mSerial;
     }
 
-    // get an OUT request from our pool
-    public UsbRequest getOutRequest() {
-        synchronized (mOutRequestPool) {
-            if (mOutRequestPool.isEmpty()) {
-                UsbRequest request = new UsbRequest();
-                request.initialize(mDeviceConnection, mEndpointOut);
-                return request;
-            } else {
-                return mOutRequestPool.removeFirst();
-            }
-        }
-    }
-
-    // return an OUT request to the pool
-    public void releaseOutRequest(UsbRequest request) {
-        synchronized (mOutRequestPool) {
-            mOutRequestPool.add(request);
-        }
-    }
-
-    // get an IN request from the pool
-    public UsbRequest getInRequest() {
-        synchronized (mInRequestPool) {
-            if (mInRequestPool.isEmpty()) {
-                UsbRequest request = new UsbRequest();
-                request.initialize(mDeviceConnection, mEndpointIn);
-                return request;
-            } else {
-                return mInRequestPool.removeFirst();
-            }
-        }
-    }
-
     public void start() {
-        mWaiterThread.start();
+        mReaderThread.start();
         connect();
     }
 
     public void stop() {
-        synchronized (mWaiterThread) {
-            mWaiterThread.mStop = true;
+        synchronized (mReaderThread) {
+            mReaderThread.mStop = true;
         }
+        mTransport.close();
+    }
+
+    // send a message to the device
+    boolean write(AdbMessage message) {
+        return mTransport.write(message);
     }
 
     public AdbSocket openSocket(String destination) {
+        return openSocket(destination, false);
+    }
+
+    // collectOutput keeps everything the device sends for AdbSocket.waitForClose()
+    public AdbSocket openSocket(String destination, boolean collectOutput) {
         AdbSocket socket;
         synchronized (mSockets) {
             int id = mNextSocketId++;
-            socket = new AdbSocket(this, id);
+            socket = new AdbSocket(this, id, collectOutput);
             mSockets.put(id, socket);
         }
         if (socket.open(destination)) {
             return socket;
         } else {
+            socketClosed(socket);
             return null;
         }
     }
@@ -164,12 +143,12 @@ public class AdbDevice {
     private void handleConnect(AdbMessage message) {
         if (message.getDataString().startsWith("device:")) {
             log("connected");
-            mActivity.deviceOnline(this);
+            mListener.deviceOnline(this);
         }
     }
 
     void log(String s) {
-        mActivity.log(s);
+        mListener.log(s);
     }
 
     // dispatch a message from the device
@@ -180,10 +159,11 @@ public class AdbDevice {
                 if (message.getArg0() == AdbMessage.AUTH_TYPE_TOKEN) {
                     AdbMessage packet = new AdbMessage();
                     if (signatureSent) {
-                        packet.set(AdbMessage.A_AUTH, AdbMessage.AUTH_TYPE_RSA_PUBLIC, 0, AdbUtils.getPublicKey());
+                        packet.set(AdbMessage.A_AUTH, AdbMessage.AUTH_TYPE_RSA_PUBLIC, 0, mSigner.getPublicKey());
                         packet.write(this);
                     } else {
-                        packet.set(AdbMessage.A_AUTH, AdbMessage.AUTH_TYPE_SIGNATURE, 0, AdbUtils.sign(message.getDataLength(), message.getData().array()));
+                        byte[] token = Arrays.copyOf(message.getData().array(), message.getDataLength());
+                        packet.set(AdbMessage.A_AUTH, AdbMessage.AUTH_TYPE_SIGNATURE, 0, mSigner.sign(token));
                         packet.write(this);
                         signatureSent = true;
                     }
@@ -209,58 +189,23 @@ public class AdbDevice {
         }
     }
 
-    private class WaiterThread extends Thread {
+    private class ReaderThread extends Thread {
         public boolean mStop;
 
         public void run() {
-            // start out with a command read
-            AdbMessage currentCommand = new AdbMessage();
-            AdbMessage currentData = null;
-            // FIXME error checking
-            currentCommand.readCommand(getInRequest());
             while (true) {
                 synchronized (this) {
                     if (mStop) {
                         return;
                     }
                 }
-                UsbRequest request = mDeviceConnection.requestWait();
-                if (request == null) {
+                // FIXME error checking
+                AdbMessage message = new AdbMessage();
+                if (!mTransport.read(message)) {
                     break;
                 }
-                AdbMessage message = (AdbMessage) request.getClientData();
-                request.setClientData(null);
-                AdbMessage messageToDispatch = null;
-                if (message == currentCommand) {
-                    int dataLength = message.getDataLength();
-                    // read data if length > 0
-                    if (dataLength > 0) {
-                        message.readData(getInRequest(), dataLength);
-                        currentData = message;
-                    } else {
-                        messageToDispatch = message;
-                    }
-                    currentCommand = null;
-                } else if (message == currentData) {
-                    messageToDispatch = message;
-                    currentData = null;
-                }
-                if (messageToDispatch != null) {
-                    // queue another read first
-                    currentCommand = new AdbMessage();
-                    currentCommand.readCommand(getInRequest());
-                    // then dispatch the current message
-                    dispatchMessage(messageToDispatch);
-                }
-                // put request back into the appropriate pool
-                if (request.getEndpoint() == mEndpointOut) {
-                    releaseOutRequest(request);
-                } else {
-                    synchronized (mInRequestPool) {
-                        mInRequestPool.add(request);
-                    }
-                }
+                dispatchMessage(message);
             }
         }
     }
-}
\ No newline at end of file
+}
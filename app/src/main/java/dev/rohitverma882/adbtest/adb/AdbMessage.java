@@ -16,8 +16,6 @@
 
 package dev.rohitverma882.adbtest.adb;
 
-import android.hardware.usb.UsbRequest;
-
 import androidx.annotation.NonNull;
 
 import java.nio.ByteBuffer;
@@ -41,11 +39,13 @@ public class AdbMessage {
     public static final int A_VERSION = 0x01000000;
     public static final int MAX_PAYLOAD = 4096;
 
+    public static final int HEADER_LENGTH = 24;
+
     private final ByteBuffer mMessageBuffer;
     private final ByteBuffer mDataBuffer;
 
     public AdbMessage() {
-        mMessageBuffer = ByteBuffer.allocate(24);
+        mMessageBuffer = ByteBuffer.allocate(HEADER_LENGTH);
         mDataBuffer = ByteBuffer.allocate(MAX_PAYLOAD);
         mMessageBuffer.order(ByteOrder.LITTLE_ENDIAN);
         mDataBuffer.order(ByteOrder.LITTLE_ENDIAN);
@@ -53,14 +53,20 @@ public class AdbMessage {
 
     // sets the fields in the command header
     public void set(int command, int arg0, int arg1, byte[] data) {
+        set(command, arg0, arg1, data, 0, (data == null ? 0 : data.length));
+    }
+
+    // sets the fields in the command header from a slice of data,
+    // length must not exceed MAX_PAYLOAD
+    public void set(int command, int arg0, int arg1, byte[] data, int offset, int length) {
         mMessageBuffer.putInt(0, command);
         mMessageBuffer.putInt(4, arg0);
         mMessageBuffer.putInt(8, arg1);
-        mMessageBuffer.putInt(12, (data == null ? 0 : data.length));
-        mMessageBuffer.putInt(16, (data == null ? 0 : checksum(data)));
+        mMessageBuffer.putInt(12, (data == null ? 0 : length));
+        mMessageBuffer.putInt(16, (data == null ? 0 : checksum(data, offset, length)));
         mMessageBuffer.putInt(20, ~command);
         if (data != null) {
-            mDataBuffer.put(data, 0, data.length);
+            mDataBuffer.put(data, offset, length);
         }
     }
 
@@ -89,6 +95,11 @@ public class AdbMessage {
         return mMessageBuffer.getInt(8);
     }
 
+    // returns the 24 byte command header
+    ByteBuffer getHeader() {
+        return mMessageBuffer;
+    }
+
     // returns command's data buffer
     public ByteBuffer getData() {
         return mDataBuffer;
@@ -108,37 +119,7 @@ public class AdbMessage {
     }
 
     public boolean write(AdbDevice device) {
-        synchronized (device) {
-            UsbRequest request = device.getOutRequest();
-            request.setClientData(this);
-            if (request.queue(mMessageBuffer, 24)) {
-                int length = getDataLength();
-                if (length > 0) {
-                    request = device.getOutRequest();
-                    request.setClientData(this);
-                    if (request.queue(mDataBuffer, length)) {
-                        return true;
-                    } else {
-                        device.releaseOutRequest(request);
-                        return false;
-                    }
-                }
-                return true;
-            } else {
-                device.releaseOutRequest(request);
-                return false;
-            }
-        }
-    }
-
-    public boolean readCommand(UsbRequest request) {
-        request.setClientData(this);
-        return request.queue(mMessageBuffer, 24);
-    }
-
-    public boolean readData(UsbRequest request, int length) {
-        request.setClientData(this);
-        return request.queue(mDataBuffer, length);
+        return device.write(this);
     }
 
     private static String extractString(ByteBuffer buffer, int offset, int length) {
@@ -149,10 +130,10 @@ public class AdbMessage {
         return new String(bytes);
     }
 
-    private static int checksum(byte[] data) {
+    private static int checksum(byte[] data, int offset, int length) {
         int result = 0;
-        for (int b : data) {
-            int x = b;
+        for (int i = offset; i < offset + length; i++) {
+            int x = data[i];
             // dang, no unsigned ints in java
             if (x < 0) x += 256;
             result += x;
@@ -16,6 +16,8 @@
 
 package dev.rohitverma882.adbtest.adb;
 
+import java.io.ByteArrayOutputStream;
+
 /* This class represents an adb socket.  adb supports multiple independent
  * socket connections to a single device.  Typically a socket is created
  * for each adb command that is executed.
@@ -26,9 +28,24 @@ public class AdbSocket {
     private final int mId;
     private int mPeerId;
 
+    // set once the device has accepted the socket
+    private boolean mOpened;
+    // set when the device has acknowledged our last A_WRTE
+    private boolean mReady;
+    private boolean mClosed;
+
+    // data received from the device, only kept for sockets whose output is
+    // read back with waitForClose() so long running streams don't grow it
+    private final ByteArrayOutputStream mOutput;
+
     public AdbSocket(AdbDevice device, int id) {
+        this(device, id, false);
+    }
+
+    public AdbSocket(AdbDevice device, int id, boolean collectOutput) {
         mDevice = device;
         mId = id;
+        mOutput = collectOutput ? new ByteArrayOutputStream() : null;
     }
 
     public int getId() {
@@ -43,27 +60,103 @@ public class AdbSocket {
         }
         synchronized (this) {
             try {
-                wait();
+                while (!mOpened && !mClosed) {
+                    wait();
+                }
             } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
                 return false;
             }
+            return mOpened;
+        }
+    }
+
+    // send a slice of data to the device, length must not exceed
+    // AdbMessage.MAX_PAYLOAD. Blocks until the device has acknowledged
+    // the previous write, so callers can pipeline writes to several sockets.
+    public boolean write(byte[] data, int offset, int length) {
+        int peerId;
+        synchronized (this) {
+            try {
+                while (!mReady && !mClosed) {
+                    wait();
+                }
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+                return false;
+            }
+            if (mClosed) {
+                return false;
+            }
+            mReady = false;
+            peerId = mPeerId;
+        }
+        AdbMessage message = new AdbMessage();
+        message.set(AdbMessage.A_WRTE, mId, peerId, data, offset, length);
+        return message.write(mDevice);
+    }
+
+    // wait for the device to close the socket and return everything it sent,
+    // or an empty string if the socket does not collect output
+    public String waitForClose() {
+        synchronized (this) {
+            try {
+                while (!mClosed) {
+                    wait();
+                }
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+                return null;
+            }
+        }
+        if (mOutput == null) {
+            return "";
+        }
+        synchronized (mOutput) {
+            return mOutput.toString();
         }
-        return true;
+    }
+
+    public void close() {
+        int peerId;
+        synchronized (this) {
+            if (mClosed) {
+                return;
+            }
+            mClosed = true;
+            peerId = mPeerId;
+            notifyAll();
+        }
+        AdbMessage message = new AdbMessage();
+        message.set(AdbMessage.A_CLSE, mId, peerId);
+        message.write(mDevice);
+        mDevice.socketClosed(this);
     }
 
     public void handleMessage(AdbMessage message) {
         switch (message.getCommand()) {
             case AdbMessage.A_OKAY:
-                mPeerId = message.getArg0();
                 synchronized (this) {
-                    notify();
+                    mPeerId = message.getArg0();
+                    mOpened = true;
+                    mReady = true;
+                    notifyAll();
                 }
                 break;
             case AdbMessage.A_WRTE:
+                if (mOutput != null) {
+                    synchronized (mOutput) {
+                        mOutput.write(message.getData().array(), 0, message.getDataLength());
+                    }
+                }
                 mDevice.log(message.getDataString());
                 sendReady();
                 break;
             case AdbMessage.A_CLSE:
+                synchronized (this) {
+                    mClosed = true;
+                    notifyAll();
+                }
                 mDevice.socketClosed(this);
                 break;
         }
@@ -0,0 +1,17 @@
+package dev.rohitverma882.adbtest.adb;
+
+/* This interface moves adb packets between an AdbDevice and the device.
+ * write() may be called from any thread, read() only from the device's
+ * reader thread.
+ */
+public interface AdbTransport {
+    // send a message, returns false if the transport is broken
+    boolean write(AdbMessage message);
+
+    // block until the next message from the device has been read into message,
+    // returns false once the transport is closed
+    boolean read(AdbMessage message);
+
+    // release the transport, unblocking a pending read() where possible
+    void close();
+}
@@ -0,0 +1,236 @@
+package dev.rohitverma882.adbtest.adb;
+
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+/* This class installs a set of split APKs on one or more devices using the
+ * package manager's install-create / install-write / install-commit commands.
+ * Every split is mapped once and streamed to every device over its own socket,
+ * all splits and devices concurrently, each device at its own pace.
+ */
+public class ApkInstaller {
+    private static final Pattern SESSION_PATTERN = Pattern.compile("\\[(\\d+)]");
+
+    private final List<AdbDevice> mDevices;
+    private final List<File> mApks;
+
+    public ApkInstaller(List<AdbDevice> devices, List<File> apks) {
+        mDevices = devices;
+        mApks = apks;
+    }
+
+    // install the splits and return the devices on which the install was committed
+    public List<AdbDevice> install() {
+        List<AdbDevice> installed = new ArrayList<>();
+        if (mApks.isEmpty() || mDevices.isEmpty()) {
+            return installed;
+        }
+
+        long size = 0;
+        for (File apk : mApks) {
+            size += apk.length();
+        }
+        final long totalSize = size;
+
+        // one thread per split and device, every write stream blocks on its own A_OKAY
+        ExecutorService executor = Executors.newFixedThreadPool(mApks.size() * mDevices.size());
+        try {
+            // create one session per device, dropping devices that refuse
+            List<Future<Integer>> creates = new ArrayList<>();
+            for (AdbDevice device : mDevices) {
+                creates.add(executor.submit(() -> createSession(device, totalSize)));
+            }
+            List<Integer> created = collect(creates, -1);
+
+            List<AdbDevice> devices = new ArrayList<>();
+            List<Integer> sessions = new ArrayList<>();
+            for (int i = 0; i < mDevices.size(); i++) {
+                if (created.get(i) < 0) {
+                    mDevices.get(i).log("install-create failed");
+                } else {
+                    devices.add(mDevices.get(i));
+                    sessions.add(created.get(i));
+                }
+            }
+            if (devices.isEmpty() || Thread.currentThread().isInterrupted()) {
+                return installed;
+            }
+
+            boolean[] succeeded = new boolean[devices.size()];
+            Arrays.fill(succeeded, true);
+
+            // map every split once, each device then streams from its own view of the
+            // mapping so a slow device never holds back the others
+            List<ByteBuffer> splits = new ArrayList<>();
+            try {
+                for (File apk : mApks) {
+                    splits.add(map(apk));
+                }
+            } catch (IOException | IllegalArgumentException e) {
+                for (AdbDevice device : devices) {
+                    device.log("failed to map splits: " + e);
+                }
+                Arrays.fill(succeeded, false);
+                splits.clear();
+            }
+
+            List<Future<Boolean>> writes = new ArrayList<>();
+            List<Integer> owners = new ArrayList<>();
+            for (int i = 0; i < splits.size(); i++) {
+                final String name = i + "_" + mApks.get(i).getName();
+                final ByteBuffer split = splits.get(i);
+                for (int j = 0; j < devices.size(); j++) {
+                    final AdbDevice device = devices.get(j);
+                    final int session = sessions.get(j);
+                    final ByteBuffer view = split.duplicate();
+                    writes.add(executor.submit(() -> writeSplit(device, session, name, view)));
+                    owners.add(j);
+                }
+            }
+            List<Boolean> written = collect(writes, false);
+            for (int i = 0; i < written.size(); i++) {
+                succeeded[owners.get(i)] &= written.get(i);
+            }
+            if (Thread.currentThread().isInterrupted()) {
+                return installed;
+            }
+
+            // commit is the slow step on the device, so run it everywhere at once
+            List<Future<Boolean>> commits = new ArrayList<>();
+            for (int i = 0; i < devices.size(); i++) {
+                final AdbDevice device = devices.get(i);
+                final int session = sessions.get(i);
+                final boolean written = succeeded[i];
+                commits.add(executor.submit(() -> finishSession(device, session, written)));
+            }
+            List<Boolean> committed = collect(commits, false);
+            for (int i = 0; i < devices.size(); i++) {
+                if (committed.get(i)) {
+                    installed.add(devices.get(i));
+                }
+            }
+            return installed;
+        } finally {
+            executor.shutdown();
+        }
+    }
+
+    // wait for every task, using failed for the ones that threw. On interrupt the
+    // remaining tasks are cancelled and the interrupt is kept for the caller.
+    private static <T> List<T> collect(List<Future<T>> futures, T failed) {
+        List<T> results = new ArrayList<>();
+        for (Future<T> future : futures) {
+            if (Thread.currentThread().isInterrupted()) {
+                future.cancel(true);
+                results.add(failed);
+                continue;
+            }
+            try {
+                results.add(future.get());
+            } catch (ExecutionException e) {
+                results.add(failed);
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+                future.cancel(true);
+                results.add(failed);
+            }
+        }
+        return results;
+    }
+
+    // returns the session id, or -1 on failure
+    private static int createSession(AdbDevice device, long totalSize) {
+        String output = execute(device, "exec:cmd package install-create -S " + totalSize);
+        if (output == null || !output.startsWith("Success")) {
+            return -1;
+        }
+        Matcher matcher = SESSION_PATTERN.matcher(output);
+        return matcher.find() ? Integer.parseInt(matcher.group(1)) : -1;
+    }
+
+    // commit the session if every split was written, abandon it otherwise
+    private static boolean finishSession(AdbDevice device, int session, boolean written) {
+        if (!written) {
+            device.log("install-write failed, abandoning session " + session);
+            execute(device, "exec:cmd package install-abandon " + session);
+            return false;
+        }
+        String output = execute(device, "exec:cmd package install-commit " + session);
+        if (output == null || !output.startsWith("Success")) {
+            device.log("install-commit failed: " + output);
+            return false;
+        }
+        return true;
+    }
+
+    private static ByteBuffer map(File apk) throws IOException {
+        try (FileInputStream stream = new FileInputStream(apk);
+             FileChannel channel = stream.getChannel()) {
+            // the mapping stays valid after the channel is closed
+            return channel.map(FileChannel.MapMode.READ_ONLY, 0, channel.size());
+        }
+    }
+
+    // stream one split to one device, the buffer is this device's own view of the mapping
+    private static boolean writeSplit(AdbDevice device, int session, String name,
+                                      ByteBuffer split) {
+        AdbSocket socket = device.openSocket("exec:cmd package install-write -S "
+                + split.remaining() + " " + session + " " + name + " -", true);
+        if (socket == null) {
+            return false;
+        }
+
+        boolean streamed = false;
+        try {
+            byte[] chunk = new byte[AdbMessage.MAX_PAYLOAD];
+            while (split.hasRemaining()) {
+                int length = Math.min(split.remaining(), chunk.length);
+                split.get(chunk, 0, length);
+                if (!socket.write(chunk, 0, length)) {
+                    return false;
+                }
+            }
+            streamed = true;
+        } finally {
+            // pm on the device is blocked reading the rest of the split from stdin
+            // until its socket goes away
+            if (!streamed) {
+                socket.close();
+            }
+        }
+
+        String output = socket.waitForClose();
+        if (output == null) {
+            // interrupted
+            socket.close();
+            return false;
+        }
+        return output.startsWith("Success");
+    }
+
+    // run a command and return its output, or null if it could not be run
+    private static String execute(AdbDevice device, String command) {
+        AdbSocket socket = device.openSocket(command, true);
+        if (socket == null) {
+            return null;
+        }
+        String output = socket.waitForClose();
+        if (output == null) {
+            // interrupted
+            socket.close();
+        }
+        return output;
+    }
+}
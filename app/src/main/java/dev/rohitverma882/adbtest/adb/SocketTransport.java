@@ -0,0 +1,66 @@
+package dev.rohitverma882.adbtest.adb;
+
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.DataInputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.net.Socket;
+
+/* adb over a stream socket, used to talk to adbd over TCP and to fake
+ * devices on loopback.
+ */
+public class SocketTransport implements AdbTransport {
+    private final Socket mSocket;
+    private final DataInputStream mInput;
+    private final OutputStream mOutput;
+
+    public SocketTransport(Socket socket) throws IOException {
+        mSocket = socket;
+        mSocket.setTcpNoDelay(true);
+        mInput = new DataInputStream(new BufferedInputStream(socket.getInputStream()));
+        mOutput = new BufferedOutputStream(socket.getOutputStream());
+    }
+
+    @Override
+    public boolean write(AdbMessage message) {
+        synchronized (mOutput) {
+            try {
+                mOutput.write(message.getHeader().array(), 0, AdbMessage.HEADER_LENGTH);
+                int length = message.getDataLength();
+                if (length > 0) {
+                    mOutput.write(message.getData().array(), 0, length);
+                }
+                mOutput.flush();
+                return true;
+            } catch (IOException e) {
+                return false;
+            }
+        }
+    }
+
+    @Override
+    public boolean read(AdbMessage message) {
+        try {
+            mInput.readFully(message.getHeader().array(), 0, AdbMessage.HEADER_LENGTH);
+            int length = message.getDataLength();
+            if (length < 0 || length > AdbMessage.MAX_PAYLOAD) {
+                return false;
+            }
+            if (length > 0) {
+                mInput.readFully(message.getData().array(), 0, length);
+            }
+            return true;
+        } catch (IOException e) {
+            return false;
+        }
+    }
+
+    @Override
+    public void close() {
+        try {
+            mSocket.close();
+        } catch (IOException ignored) {
+        }
+    }
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package dev.rohitverma882.adbtest.adb;
+
+import android.hardware.usb.UsbConstants;
+import android.hardware.usb.UsbDeviceConnection;
+import android.hardware.usb.UsbEndpoint;
+import android.hardware.usb.UsbInterface;
+import android.hardware.usb.UsbRequest;
+
+import java.util.LinkedList;
+
+/* adb over the bulk endpoints of a USB interface, using asynchronous requests. */
+public class UsbTransport implements AdbTransport {
+    private final UsbDeviceConnection mDeviceConnection;
+    private final UsbEndpoint mEndpointOut;
+    private final UsbEndpoint mEndpointIn;
+
+    // pool of requests for the OUT endpoint
+    private final LinkedList<UsbRequest> mOutRequestPool = new LinkedList<>();
+
+    // pool of requests for the IN endpoint
+    private final LinkedList<UsbRequest> mInRequestPool = new LinkedList<>();
+
+    public UsbTransport(UsbDeviceConnection connection, UsbInterface adbInterface) {
+        mDeviceConnection = connection;
+
+        UsbEndpoint epOut = null;
+        UsbEndpoint epIn = null;
+
+        // look for our bulk endpoints
+        for (int i = 0; i < adbInterface.getEndpointCount(); i++) {
+            UsbEndpoint ep = adbInterface.getEndpoint(i);
+            if (ep.getType() == UsbConstants.USB_ENDPOINT_XFER_BULK) {
+                if (ep.getDirection() == UsbConstants.USB_DIR_OUT) {
+                    epOut = ep;
+                } else {
+                    epIn = ep;
+                }
+            }
+        }
+
+        if (epOut == null || epIn == null) {
+            throw new IllegalArgumentException("not all endpoints found");
+        }
+
+        mEndpointOut = epOut;
+        mEndpointIn = epIn;
+    }
+
+    // get an OUT request from our pool
+    private UsbRequest getOutRequest() {
+        synchronized (mOutRequestPool) {
+            if (mOutRequestPool.isEmpty()) {
+                UsbRequest request = new UsbRequest();
+                request.initialize(mDeviceConnection, mEndpointOut);
+                return request;
+            } else {
+                return mOutRequestPool.removeFirst();
+            }
+        }
+    }
+
+    // return an OUT request to the pool
+    private void releaseOutRequest(UsbRequest request) {
+        synchronized (mOutRequestPool) {
+            mOutRequestPool.add(request);
+        }
+    }
+
+    // get an IN request from the pool
+    private UsbRequest getInRequest() {
+        synchronized (mInRequestPool) {
+            if (mInRequestPool.isEmpty()) {
+                UsbRequest request = new UsbRequest();
+                request.initialize(mDeviceConnection, mEndpointIn);
+                return request;
+            } else {
+                return mInRequestPool.removeFirst();
+            }
+        }
+    }
+
+    // return an IN request to the pool
+    private void releaseInRequest(UsbRequest request) {
+        synchronized (mInRequestPool) {
+            mInRequestPool.add(request);
+        }
+    }
+
+    @Override
+    public boolean write(AdbMessage message) {
+        synchronized (this) {
+            UsbRequest request = getOutRequest();
+            // keeps the message alive until the request completes
+            request.setClientData(message);
+            if (request.queue(message.getHeader(), AdbMessage.HEADER_LENGTH)) {
+                int length = message.getDataLength();
+                if (length > 0) {
+                    request = getOutRequest();
+                    request.setClientData(message);
+                    if (request.queue(message.getData(), length)) {
+                        return true;
+                    } else {
+                        releaseOutRequest(request);
+                        return false;
+                    }
+                }
+                return true;
+            } else {
+                releaseOutRequest(request);
+                return false;
+            }
+        }
+    }
+
+    @Override
+    public boolean read(AdbMessage message) {
+        UsbRequest request = getInRequest();
+        if (!request.queue(message.getHeader(), AdbMessage.HEADER_LENGTH)) {
+            releaseInRequest(request);
+            return false;
+        }
+        if (!waitFor(request)) {
+            return false;
+        }
+        // read data if length > 0
+        int length = message.getDataLength();
+        if (length > 0) {
+            request = getInRequest();
+            if (!request.queue(message.getData(), length)) {
+                releaseInRequest(request);
+                return false;
+            }
+            return waitFor(request);
+        }
+        return true;
+    }
+
+    // wait for an IN request to complete, recycling the OUT requests that
+    // complete in the meantime
+    private boolean waitFor(UsbRequest inRequest) {
+        while (true) {
+            UsbRequest request = mDeviceConnection.requestWait();
+            if (request == null) {
+                return false;
+            }
+            // put request back into the appropriate pool
+            if (request.getEndpoint() == mEndpointOut) {
+                request.setClientData(null);
+                releaseOutRequest(request);
+            } else {
+                releaseInRequest(request);
+                if (request == inRequest) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    @Override
+    public void close() {
+        // the UsbDeviceConnection belongs to MainActivity, closing it there makes
+        // requestWait() return null and ends the reader
+    }
+}
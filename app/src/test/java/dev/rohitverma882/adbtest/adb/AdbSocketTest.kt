@@ -0,0 +1,130 @@
+package dev.rohitverma882.adbtest.adb
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertThrows
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Test
+import org.mockito.ArgumentMatchers.any
+import org.mockito.Mockito.mock
+import org.mockito.Mockito.`when`
+
+import java.util.concurrent.Callable
+import java.util.concurrent.Executors
+import java.util.concurrent.TimeUnit
+import java.util.concurrent.TimeoutException
+
+/**
+ * Open/ready/close state handling of [AdbSocket], with the device mocked out.
+ */
+class AdbSocketTest {
+    private val executor = Executors.newCachedThreadPool()
+
+    private lateinit var device: AdbDevice
+    private lateinit var socket: AdbSocket
+
+    @Before
+    fun setUp() {
+        device = mock(AdbDevice::class.java)
+        `when`(device.write(any(AdbMessage::class.java))).thenReturn(true)
+        socket = AdbSocket(device, LOCAL_ID, true)
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun open_succeedsOnOkay() {
+        val opened = executor.submit(Callable { socket.open("shell:") })
+        socket.handleMessage(message(AdbMessage.A_OKAY, PEER_ID, LOCAL_ID))
+        assertTrue(opened.get())
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun open_keepsOkayReceivedBeforeWaiting() {
+        // the device answers while A_OPEN is still being queued
+        `when`(device.write(any(AdbMessage::class.java))).thenAnswer {
+            socket.handleMessage(message(AdbMessage.A_OKAY, PEER_ID, LOCAL_ID))
+            true
+        }
+        assertTrue(socket.open("shell:"))
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun open_failsWhenDeviceCloses() {
+        val opened = executor.submit(Callable { socket.open("shell:") })
+        socket.handleMessage(message(AdbMessage.A_CLSE, 0, LOCAL_ID))
+        assertFalse(opened.get())
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun write_waitsForOkay() {
+        open()
+        assertTrue(socket.write(DATA, 0, DATA.size))
+
+        val written = executor.submit(Callable { socket.write(DATA, 0, DATA.size) })
+        assertThrows(TimeoutException::class.java) {
+            written.get(BLOCKED_MILLIS, TimeUnit.MILLISECONDS)
+        }
+
+        socket.handleMessage(message(AdbMessage.A_OKAY, PEER_ID, LOCAL_ID))
+        assertTrue(written.get())
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun write_failsAfterClose() {
+        open()
+        socket.handleMessage(message(AdbMessage.A_CLSE, PEER_ID, LOCAL_ID))
+        assertFalse(socket.write(DATA, 0, DATA.size))
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun write_failsWhenClosedWhileWaiting() {
+        open()
+        assertTrue(socket.write(DATA, 0, DATA.size))
+
+        val written = executor.submit(Callable { socket.write(DATA, 0, DATA.size) })
+        socket.close()
+        assertFalse(written.get())
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun waitForClose_returnsOutput() {
+        open()
+        socket.handleMessage(message(AdbMessage.A_WRTE, PEER_ID, LOCAL_ID, "Success: "))
+        socket.handleMessage(message(AdbMessage.A_WRTE, PEER_ID, LOCAL_ID, "created"))
+        socket.handleMessage(message(AdbMessage.A_CLSE, PEER_ID, LOCAL_ID))
+        assertEquals("Success: created", socket.waitForClose())
+    }
+
+    @Test(timeout = TIMEOUT_MILLIS)
+    fun waitForClose_doesNotBufferByDefault() {
+        socket = AdbSocket(device, LOCAL_ID)
+        open()
+        socket.handleMessage(message(AdbMessage.A_WRTE, PEER_ID, LOCAL_ID, "logcat line"))
+        socket.handleMessage(message(AdbMessage.A_CLSE, PEER_ID, LOCAL_ID))
+        assertEquals("", socket.waitForClose())
+    }
+
+    private fun open() {
+        val opened = executor.submit(Callable { socket.open("shell:") })
+        socket.handleMessage(message(AdbMessage.A_OKAY, PEER_ID, LOCAL_ID))
+        assertTrue(opened.get())
+    }
+
+    private fun message(command: Int, arg0: Int, arg1: Int, data: String? = null): AdbMessage {
+        val message = AdbMessage()
+        if (data == null) {
+            message.set(command, arg0, arg1)
+        } else {
+            message.set(command, arg0, arg1, data.toByteArray())
+        }
+        return message
+    }
+
+    companion object {
+        private const val LOCAL_ID = 1
+        private const val PEER_ID = 42
+        private const val TIMEOUT_MILLIS = 5000L
+        private const val BLOCKED_MILLIS = 200L
+        private val DATA = ByteArray(16)
+    }
+}
@@ -0,0 +1,156 @@
+package dev.rohitverma882.adbtest.adb
+
+import org.junit.After
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Assume.assumeTrue
+import org.junit.Before
+import org.junit.Rule
+import org.junit.Test
+import org.junit.rules.TemporaryFolder
+
+import java.io.File
+import java.net.InetAddress
+import java.net.Socket
+import java.security.KeyFactory
+import java.security.PrivateKey
+import java.security.Signature
+import java.security.spec.PKCS8EncodedKeySpec
+import java.util.Base64
+import java.util.Random
+import java.util.concurrent.CountDownLatch
+import java.util.concurrent.TimeUnit
+import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.atomic.AtomicLong
+import kotlin.concurrent.thread
+
+/**
+ * Installs split APKs with [ApkInstaller] on fake devices served by `adb_bench --serve`
+ * over TCP loopback, and reports install time, throughput and heap growth.
+ *
+ * Skipped unless ADB_BENCH points at an adb_bench binary (see README):
+ *
+ *     ADB_BENCH=build/bench/adb_bench ./gradlew :app:testDebugUnitTest --tests '*ApkInstallerBenchmarkTest'
+ *
+ * ADB_BENCH_DEVICES, ADB_BENCH_SPLITS, ADB_BENCH_SPLIT_BYTES and ADB_BENCH_COMMIT_DELAY_US
+ * override the defaults. Results are printed to the test's standard output.
+ */
+class ApkInstallerBenchmarkTest {
+    @get:Rule
+    val folder = TemporaryFolder()
+
+    private var server: Process? = null
+    private val devices = mutableListOf<AdbDevice>()
+
+    @Before
+    fun setUp() {
+        assumeTrue("ADB_BENCH not set", System.getenv("ADB_BENCH") != null)
+    }
+
+    @After
+    fun tearDown() {
+        devices.forEach { it.stop() }
+        server?.destroy()
+    }
+
+    @Test
+    fun install() {
+        val deviceCount = env("ADB_BENCH_DEVICES", 4)
+        val splitCount = env("ADB_BENCH_SPLITS", 3)
+        val splitBytes = env("ADB_BENCH_SPLIT_BYTES", 8 * 1024 * 1024)
+        val commitDelayUs = env("ADB_BENCH_COMMIT_DELAY_US", 0)
+
+        // adb_bench generates the key and trusts it on every fake device
+        val key = File(folder.root, "adbkey")
+        val process = ProcessBuilder(
+            System.getenv("ADB_BENCH"), "--serve", "0", "--key", key.path,
+            "--commit-delay", commitDelayUs.toString()
+        ).redirectError(ProcessBuilder.Redirect.INHERIT).start()
+        server = process
+        val line = process.inputStream.bufferedReader().readLine() ?: error("adb_bench --serve failed")
+        val port = line.removePrefix("port ").trim().toInt()
+
+        val signer = PemSigner(key)
+        val online = CountDownLatch(deviceCount)
+        val listener = object : AdbDevice.Listener {
+            override fun log(s: String) {}
+
+            override fun deviceOnline(device: AdbDevice) = online.countDown()
+        }
+        repeat(deviceCount) {
+            val socket = Socket(InetAddress.getLoopbackAddress(), port)
+            val device = AdbDevice(listener, SocketTransport(socket), "fake$it", signer)
+            devices.add(device)
+            device.start()
+        }
+        assertTrue(online.await(TIMEOUT_SECONDS, TimeUnit.SECONDS))
+
+        val random = Random(0)
+        val splits = List(splitCount) { i ->
+            File(folder.root, "split$i.apk").apply {
+                writeBytes(ByteArray(splitBytes).also { random.nextBytes(it) })
+            }
+        }
+
+        val runtime = Runtime.getRuntime()
+        System.gc()
+        val heapBefore = runtime.totalMemory() - runtime.freeMemory()
+        val heapPeak = AtomicLong(heapBefore)
+        val sampling = AtomicBoolean(true)
+        val sampler = thread {
+            while (sampling.get()) {
+                heapPeak.accumulateAndGet(runtime.totalMemory() - runtime.freeMemory()) { a, b -> maxOf(a, b) }
+                Thread.sleep(SAMPLE_MILLIS)
+            }
+        }
+
+        val start = System.nanoTime()
+        val installed = ApkInstaller(devices, splits).install()
+        val seconds = (System.nanoTime() - start) / 1e9
+        sampling.set(false)
+        sampler.join()
+
+        val splitMegabytes = splitBytes / (1024.0 * 1024)
+        println(
+            "ApkInstaller: devices %d (%d failed), %d splits x %.3f MB, commit delay %d us".format(
+                deviceCount, deviceCount - installed.size, splitCount, splitMegabytes, commitDelayUs
+            )
+        )
+        println("%-20s %10.3f".format("total ms", seconds * 1000))
+        println("%-20s %10.3f".format("MB/s delivered", splitMegabytes * splitCount * installed.size / seconds))
+        println("%-20s %10d".format("peak heap growth KB", (heapPeak.get() - heapBefore) / 1024))
+
+        assertEquals(deviceCount, installed.size)
+    }
+
+    private fun env(name: String, default: Int) = System.getenv(name)?.toInt() ?: default
+
+    // signs like RSA_sign(NID_sha1, ...) in adbutils: PKCS#1 v1.5 with the token as the SHA-1 digest
+    private class PemSigner(file: File) : AdbDevice.Signer {
+        private val key: PrivateKey = run {
+            val base64 = file.readLines().filterNot { it.startsWith("-----") }.joinToString("")
+            val spec = PKCS8EncodedKeySpec(Base64.getDecoder().decode(base64))
+            KeyFactory.getInstance("RSA").generatePrivate(spec)
+        }
+
+        override fun sign(token: ByteArray): ByteArray {
+            val signature = Signature.getInstance("NONEwithRSA")
+            signature.initSign(key)
+            signature.update(SHA1_DIGEST_INFO)
+            signature.update(token)
+            return signature.sign()
+        }
+
+        // never needed, the fake devices already trust the key
+        override fun getPublicKey(): ByteArray = ByteArray(0)
+    }
+
+    companion object {
+        private const val TIMEOUT_SECONDS = 30L
+        private const val SAMPLE_MILLIS = 5L
+
+        private val SHA1_DIGEST_INFO = byteArrayOf(
+            0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00, 0x04, 0x14
+        )
+    }
+}